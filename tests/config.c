@@ -0,0 +1,71 @@
+/* Builds tharness header only with every compile time switch changed from its default. */
+#include <stdarg.h>
+
+int config_vprintf(const char* msg, va_list args);
+
+#define THARNESS_IMPLEMENTATION
+#define THARNESS_THREAD_SAFE		(0)
+#define THARNESS_VERBOSE			(0)
+#define THARNESS_COUNT_T			uint8_t
+#define THARNESS_HISTOGRAM_COUNT_T	uint32_t
+#define THARNESS_VPRINTF(msg, args)	config_vprintf(msg, args)
+#include "tharness.h"
+
+static unsigned config_writes;
+
+int config_vprintf(const char* msg, va_list args)
+{
+	config_writes++;
+
+	return vprintf(msg, args);
+}
+
+TEST(test_counter_widths)
+{
+	static TharnessHistogram hist;
+
+	EXPECT(sizeof(tharness.total) == 1);
+	EXPECT(sizeof(hist.counts[0]) == 4);
+}
+
+TEST(test_verbose_disabled)
+{
+	unsigned writes = config_writes;
+
+	/* Passing output is compiled out even though tharness_init(true) requested it */
+	EXPECT(1);
+	PRINT_LINE("Passing test message");
+
+	EXPECT(config_writes == writes);
+}
+
+TEST(test_histogram)
+{
+	static TharnessHistogram hist;
+	uint64_t i;
+
+	for(i = 1; i <= 100; i++)
+	{
+		tharness_histogram_record(&hist, i);
+	}
+
+	EXPECT_P50_BELOW(&hist, 51);
+	EXPECT_P99_BELOW(&hist, 100);
+	EXPECT_MAX_BELOW(&hist, 101);
+}
+
+
+int main()
+{
+	tharness_init(true);
+
+	RUN(test_counter_widths);
+	RUN(test_verbose_disabled);
+	RUN(test_histogram);
+
+	/* The results go through the custom sink */
+	config_writes = 0;
+	int failures = tharness_results();
+
+	return failures != 0 || config_writes == 0;
+}
@@ -68,6 +68,74 @@ TEST(test_arrays)
 	TEST_PASS("Arrays are equal");
 }
 
+#if THARNESS_THREAD_SAFE
+TEST(thread_local_work)
+{
+	static _Thread_local volatile unsigned counter;
+
+	counter++;
+}
+
+TEST(test_concurrent)
+{
+	/* The scaling curve is printed in verbose mode or by a failing EXPECT_SPEEDUP */
+	RUN_CONCURRENT(thread_local_work, 4, 20);
+
+	EXPECT(tharness.scaling.count == 3);
+	EXPECT(tharness.scaling.points[2].threads == 4);
+	EXPECT_FAIRNESS(0.5);
+	EXPECT_SPEEDUP(0.5);
+
+	/* A failing speedup prints the scaling curve */
+	EXPECT_SPEEDUP(64.0);
+}
+#endif
+
+TEST(test_histogram)
+{
+	static TharnessHistogram hist;
+	static TharnessHistogram large;
+	uint64_t i;
+
+	for(i = 1; i <= 1000; i++)
+	{
+		tharness_histogram_record(&hist, i);
+	}
+
+	EXPECT(tharness_histogram_count(&hist) == 1000);
+	EXPECT(tharness_histogram_percentile(&hist, 0.0) == 1);
+	EXPECT(tharness_histogram_percentile(&hist, 99.9) == 999);
+	EXPECT_P50_BELOW(&hist, 510);
+	EXPECT_P99_BELOW(&hist, 1000);
+	EXPECT_MAX_BELOW(&hist, 1001);
+
+	/* The minimum is exact outside of the exact buckets */
+	tharness_histogram_record(&large, 1000);
+	tharness_histogram_record(&large, 200);
+	EXPECT(tharness_histogram_min(&large) == 200);
+
+	/* A failing percentile prints the distribution */
+	EXPECT_P999_BELOW(&hist, 900);
+}
+
+TEST(test_histogram_rank)
+{
+	static TharnessHistogram hist;
+	uint64_t i;
+
+	/* Nearest rank: 1 of 60 samples is above p98.3, so p99 is the largest sample */
+	for(i = 1; i <= 60; i++)
+	{
+		tharness_histogram_record(&hist, i);
+	}
+
+	EXPECT(tharness_histogram_percentile(&hist, 99.0) == 60);
+	EXPECT(tharness_histogram_percentile(&hist, 50.0) == 30);
+	EXPECT(tharness_histogram_percentile(&hist, -1.0) == 1);
+	EXPECT(tharness_histogram_percentile(&hist, 0.0 / 0.0) == 1);
+	EXPECT_P99_BELOW(&hist, 61);
+}
+
 
 int main()
 {
@@ -82,6 +150,11 @@ int main()
 	RUN(test_ignored);
 	RUN(test_ints);
 	RUN(test_arrays);
+	#if THARNESS_THREAD_SAFE
+	RUN(test_concurrent);
+	#endif
+	RUN(test_histogram);
+	RUN(test_histogram_rank);
 
 	return tharness_results();
 }
@@ -12,7 +12,19 @@
  * 				ANY KIND, either express or implied. See the License for the specific language
  * 				governing permissions and limitations under the License.
  *
- * @desc		Tharness is a testing framework for c.
+ * @desc		Tharness is a testing framework for c. It can be built as a library from tharness.c or
+ * 				used header only by defining THARNESS_IMPLEMENTATION in exactly one source file before
+ * 				including this header:
+ *
+ * 					#define THARNESS_IMPLEMENTATION
+ * 					#include "tharness.h"
+ *
+ * 				The header does not define feature test macros. Timing uses CLOCK_MONOTONIC when
+ * 				<time.h> provides it (the default with glibc, or with _POSIX_C_SOURCE), otherwise
+ * 				timespec_get in C11 or clock in C99.
+ *
+ * 				Defining the implementation in the same file as the tests lets the compiler inline
+ * 				and specialize EXPECT, PRINT and the state handling without LTO.
  *
  ***************************************************************************************************/
 #ifndef THARNESS_H
@@ -22,6 +34,37 @@
 #error Compile with C99 or higher!
 #endif
 
+
+/* Configuration ---------------------------------------------------------------------------------
+ * Compile time switches. These must be the same in every file including tharness.h and in the
+ * build of tharness.c. Disabled features are removed by the preprocessor.
+ *
+ * 	THARNESS_VERBOSE				0 removes passing output, ignoring tharness_init(true).
+ * 	THARNESS_THREAD_SAFE			0 removes locking and RUN_CONCURRENT. No pthread dependency.
+ * 	THARNESS_COUNT_T				Type of the test, failure, and ignore counters.
+ * 	THARNESS_HISTOGRAM_COUNT_T		Type of the histogram bucket counters.
+ * 	THARNESS_VPRINTF(msg, args)		Output sink taking a format string and a va_list.
+ */
+#ifndef THARNESS_VERBOSE
+#define THARNESS_VERBOSE			(1)
+#endif
+
+#ifndef THARNESS_THREAD_SAFE
+#define THARNESS_THREAD_SAFE		(1)
+#endif
+
+#ifndef THARNESS_COUNT_T
+#define THARNESS_COUNT_T			unsigned
+#endif
+
+#ifndef THARNESS_HISTOGRAM_COUNT_T
+#define THARNESS_HISTOGRAM_COUNT_T	uint64_t
+#endif
+
+#ifndef THARNESS_VPRINTF
+#define THARNESS_VPRINTF(msg, args)	vprintf(msg, args)
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -35,14 +78,63 @@ extern "C" {
 #include <string.h>
 
 
+/* Public Constants ------------------------------------------------------------------------------ */
+#ifndef THARNESS_MAX_THREADS
+#define THARNESS_MAX_THREADS	(64)	/// Maximum number of threads started by RUN_CONCURRENT.
+#endif
+
+#ifndef THARNESS_MAX_POINTS
+#define THARNESS_MAX_POINTS		(16)	/// Maximum number of points recorded in a scaling curve.
+#endif
+
+#if THARNESS_MAX_POINTS < 2
+#error THARNESS_MAX_POINTS must hold at least the single threaded and nthreads points!
+#endif
+
+#ifndef THARNESS_HISTOGRAM_BITS
+#define THARNESS_HISTOGRAM_BITS	(7)		/// Sub-bucket bits per power of two (relative error 2^-(bits-1)).
+#endif
+
+#define THARNESS_HISTOGRAM_BUCKETS \
+	((66 - THARNESS_HISTOGRAM_BITS) << (THARNESS_HISTOGRAM_BITS - 1))
+
+#ifndef THARNESS_CACHE_LINE
+#define THARNESS_CACHE_LINE		(64)	/// Size of a cache line used to pad per-thread counters.
+#endif
+
+
 /* Public Types ---------------------------------------------------------------------------------- */
+#if THARNESS_THREAD_SAFE
+typedef struct {
+	unsigned threads;		/// Number of threads run concurrently.
+	uint64_t ops;			/// Total number of iterations of the test body across all threads.
+	double   seconds;		/// Measured duration of the run.
+	double   ops_per_sec;	/// Total throughput across all threads.
+	double   fairness;		/// Jain's fairness index of per-thread ops (1/threads to 1.0).
+} TharnessScalingPoint;
+
 typedef struct {
-	unsigned total;			/// Total number of tests run.
-	unsigned failures;		/// Total number of failing tests.
-	unsigned ignores;		/// Total number of tests ignored.
+	unsigned count;			/// Number of valid points.
+	TharnessScalingPoint points[THARNESS_MAX_POINTS];
+} TharnessScaling;
+#endif
+
+typedef struct {
+	uint64_t max;			/// Largest sample recorded.
+	uint64_t inv_min;		/// Complement of the smallest sample so a zeroed histogram is empty.
+	THARNESS_HISTOGRAM_COUNT_T counts[THARNESS_HISTOGRAM_BUCKETS];
+} TharnessHistogram;
+
+typedef struct {
+	THARNESS_COUNT_T total;		/// Total number of tests run.
+	THARNESS_COUNT_T failures;	/// Total number of failing tests.
+	THARNESS_COUNT_T ignores;	/// Total number of tests ignored.
 	unsigned state;
 	bool at_new_line;		/// Indicates if printing is at the start of a new line.
 	bool verbose;			/// False suppresses non-failing and non-ignored output.
+	#if THARNESS_THREAD_SAFE
+	TharnessScaling scaling;/// Scaling curve of the last RUN_CONCURRENT.
+	#endif
 } Tharness;
 
 
@@ -55,6 +147,12 @@ extern Tharness tharness;
 
 #define RUN(test) \
 	tharness_run(test)
+#if THARNESS_THREAD_SAFE
+#define RUN_CONCURRENT(test, nthreads, duration) \
+	tharness_run_concurrent(test, nthreads, duration, __FILE__, __func__, __LINE__)
+#define THREAD_ID() \
+	tharness_thread_id()
+#endif
 #define EXPECT(...)	\
 	THARNESS_APPEND_NARGS(EXPECT, __VA_ARGS__)
 #define EXPECT_MESSAGE(condition, ...) \
@@ -63,6 +161,22 @@ extern Tharness tharness;
 	tharness_expect((condition), __FILE__, __func__, __LINE__, #condition, 0)
 #define EXPECT2(condition, ...) \
 	EXPECT_MESSAGE(condition, __VA_ARGS__)
+#if THARNESS_THREAD_SAFE
+#define EXPECT_SPEEDUP(min) \
+	tharness_expect_speedup((min), __FILE__, __func__, __LINE__, #min)
+#define EXPECT_FAIRNESS(min) \
+	tharness_expect_fairness((min), __FILE__, __func__, __LINE__, #min)
+#endif
+#define EXPECT_PERCENTILE_BELOW(hist, percentile, ns) \
+	tharness_expect_percentile((hist), (percentile), (ns), __FILE__, __func__, __LINE__, #ns)
+#define EXPECT_P50_BELOW(hist, ns) \
+	EXPECT_PERCENTILE_BELOW(hist, 50.0, ns)
+#define EXPECT_P99_BELOW(hist, ns) \
+	EXPECT_PERCENTILE_BELOW(hist, 99.0, ns)
+#define EXPECT_P999_BELOW(hist, ns) \
+	EXPECT_PERCENTILE_BELOW(hist, 99.9, ns)
+#define EXPECT_MAX_BELOW(hist, ns) \
+	EXPECT_PERCENTILE_BELOW(hist, 100.0, ns)
 
 
 #define PRINT(...) \
@@ -165,10 +279,1162 @@ void tharness_pass      (const char*, const char*, int32_t, const char*, ...);
 void tharness_fail      (const char*, const char*, int32_t, const char*, ...);
 void tharness_ignore    (const char*, const char*, int32_t, const char*, ...);
 
+#if THARNESS_THREAD_SAFE
+void     tharness_run_concurrent (void (*test)(void), unsigned, unsigned, const char*, const char*, int32_t);
+unsigned tharness_thread_id      (void);
+void     tharness_expect_speedup (double, const char*, const char*, int32_t, const char*);
+void     tharness_expect_fairness(double, const char*, const char*, int32_t, const char*);
+#endif
+
+void tharness_expect_percentile(const TharnessHistogram*, double, uint64_t, const char*, const char*, int32_t, const char*);
+
+uint64_t tharness_clock_ns              (void);
+void     tharness_histogram_clear       (TharnessHistogram*);
+void     tharness_histogram_merge       (TharnessHistogram*, const TharnessHistogram*);
+uint64_t tharness_histogram_count       (const TharnessHistogram*);
+uint64_t tharness_histogram_min         (const TharnessHistogram*);
+uint64_t tharness_histogram_percentile  (const TharnessHistogram*, double);
+
+
+/* Public Inline Functions ----------------------------------------------------------------------- */
+/* tharness_histogram_record ********************************************************************//**
+ * @brief		Records a sample in nanoseconds. Samples below 2^THARNESS_HISTOGRAM_BITS are recorded
+ * 				exactly. Larger samples are recorded in log-linear buckets with a relative error of
+ * 				at most 2^-(THARNESS_HISTOGRAM_BITS-1). Inlined so it can wrap hot path calls:
+ *
+ * 					uint64_t start = tharness_clock_ns();
+ * 					queue_push(&queue, item);
+ * 					tharness_histogram_record(&hist, tharness_clock_ns() - start);
+ *
+ * @warning		Not thread safe. Record into one histogram per thread and combine them with
+ * 				tharness_histogram_merge. */
+static inline void tharness_histogram_record(TharnessHistogram* hist, uint64_t ns)
+{
+	unsigned index = (unsigned)ns;
+
+	if(ns >= (UINT64_C(1) << THARNESS_HISTOGRAM_BITS))
+	{
+		#if defined(__GNUC__) || defined(__clang__)
+		unsigned msb = 63 - (unsigned)__builtin_clzll(ns);
+		#else
+		unsigned msb = 0;
+		uint64_t v;
+		for(v = ns; v >>= 1; msb++) { }
+		#endif
+
+		unsigned shift = msb - THARNESS_HISTOGRAM_BITS + 1;
+
+		index = (shift << (THARNESS_HISTOGRAM_BITS - 1)) + (unsigned)(ns >> shift);
+	}
+
+	hist->counts[index]++;
+
+	if(ns > hist->max)
+	{
+		hist->max = ns;
+	}
+
+	if(~ns > hist->inv_min)
+	{
+		hist->inv_min = ~ns;
+	}
+}
+
 
 #ifdef __cplusplus
 }
 #endif
 
 #endif // THARNESS_H
+
+
+/* Implementation -------------------------------------------------------------------------------- */
+#if defined(THARNESS_IMPLEMENTATION) && !defined(THARNESS_IMPLEMENTED)
+#define THARNESS_IMPLEMENTED
+
+#if THARNESS_THREAD_SAFE
+#if __STDC_VERSION__ < 201112L
+#error Compile with C11 or higher or define THARNESS_THREAD_SAFE as 0!
+#endif
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+#include <float.h>
+#include <time.h>
+
+
+/* Private Types --------------------------------------------------------------------------------- */
+typedef enum {
+	THARNESS_NORMAL_STATE,
+	THARNESS_IGNORING_STATE,
+	THARNESS_IGNORED_STATE,
+	THARNESS_FAILING_STATE,
+	THARNESS_FAILED_STATE,
+	THARNESS_RESULTS_STATE,
+} TharnessState;
+
+typedef enum {
+	THARNESS_FAILED_EVENT,
+	THARNESS_PASSED_EVENT,
+	THARNESS_IGNORED_EVENT,
+	THARNESS_RUN_TEST_EVENT,
+	THARNESS_RUN_EXPECT_EVENT,
+	THARNESS_RESULTS_EVENT,
+} TharnessEvent;
+
+#if THARNESS_THREAD_SAFE
+typedef union {
+	uint64_t ops;							/// Iterations of the test body completed by one thread.
+	char     pad[THARNESS_CACHE_LINE];		/// Pads each counter to a full cache line.
+} TharnessCounter;
+
+typedef struct {
+	void   (*test)(void);
+	unsigned id;
+} TharnessWorker;
+#endif
+
+
+/* Private Functions ----------------------------------------------------------------------------- */
+static        void tharness_handle       (unsigned);
+#if THARNESS_THREAD_SAFE
+static        bool tharness_run_point    (void (*test)(void), unsigned, unsigned, const char*, const char*, int32_t);
+static        void* tharness_worker      (void* arg);
+static        void tharness_expect_scaling(bool, const char*, const char*, int32_t, const char*, double, const char*);
+static        void tharness_print_scaling(void);
+#endif
+static        void tharness_print_histogram(const TharnessHistogram*);
+static        uint64_t tharness_histogram_value(unsigned index);
+static        void tharness_output       (const char* msg, ...);
+static        void tharness_write        (int indent, const char* msg, ...);
+static        void tharness_write_line   (int indent, const char* msg, ...);
+static inline void tharness_lock         (void);
+static inline void tharness_unlock       (void);
+static inline void tharness_print_passed (const char* file, const char* func, int32_t line);
+static inline void tharness_print_failed (const char* file, const char* func, int32_t line);
+static inline void tharness_print_ignored(const char* file, const char* func, int32_t line);
+static inline bool tharness_can_output   (void);
+static inline void tharness_vprint       (int indent, const char* msg, va_list args);
+static inline void tharness_vprint_line  (int indent, const char* msg, va_list args);
+
+
+/* Global Variables ------------------------------------------------------------------------------ */
+Tharness tharness;
+
+
+/* Private Variables ----------------------------------------------------------------------------- */
+#if THARNESS_THREAD_SAFE
+static pthread_mutex_t tharness_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t tharness_gate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  tharness_gate_cond = PTHREAD_COND_INITIALIZER;
+static unsigned        tharness_gate_ready;
+static bool            tharness_gate_open;
+static atomic_bool     tharness_stop;
+static _Alignas(THARNESS_CACHE_LINE) TharnessCounter tharness_counters[THARNESS_MAX_THREADS];
+static _Thread_local unsigned tharness_thread;
+#endif
+
+
+/* tharness_init ********************************************************************************//**
+ * @brief		Initializes a test harness before any tests are run. */
+void tharness_init(bool verbose)
+{
+	tharness.total    = 0;
+	tharness.failures = 0;
+	tharness.ignores  = 0;
+	tharness.state    = THARNESS_NORMAL_STATE;
+	tharness.verbose  = verbose;
+
+	#if THARNESS_THREAD_SAFE
+	tharness.scaling.count = 0;
+	#endif
+}
+
+
+/* tharness_result ******************************************************************************//**
+ * @brief		Prints the results after running all tests.
+ * @desc		Example output on a new line:
+ *
+ *				3 Tests 1 Failed 0 Ignored
+ *				OK
+ */
+int tharness_results(void)
+{
+	tharness_handle(THARNESS_RESULTS_EVENT);
+
+	tharness_print_line(0, "\n%lu Tests %lu Failed %lu Ignored", (unsigned long)tharness.total,
+		(unsigned long)tharness.failures, (unsigned long)tharness.ignores);
+
+	if(tharness.failures == 0)
+	{
+		tharness_print_line(0, "OK");
+	}
+	else
+	{
+		tharness_print_line(0, "FAIL");
+	}
+
+	return tharness.failures;
+}
+
+
+/* tharness_run *********************************************************************************//**
+ * @brief		Runs a tharness test. */
+void tharness_run(void (*test)(void))
+{
+	tharness_handle(THARNESS_RUN_TEST_EVENT);
+
+	test();
+}
+
+
+#if THARNESS_THREAD_SAFE
+/* tharness_run_concurrent **********************************************************************//**
+ * @brief		Runs the body of a test repeatedly on multiple threads and records the throughput in
+ * 				tharness.scaling. Unlike RUN, this does not start a new test: it is called from
+ * 				within a TEST so that the results can be checked with EXPECT_SPEEDUP and
+ * 				EXPECT_FAIRNESS. Example:
+ *
+ * 					TEST(queue_push_pop) { ... }
+ *
+ * 					TEST(test_queue_scaling)
+ * 					{
+ * 						RUN_CONCURRENT(queue_push_pop, 8, 100);
+ * 						EXPECT_SPEEDUP(4.0);
+ * 					}
+ *
+ * 				The body is run with 1, 2, 4, ... threads, doubling up to nthreads. Each point of the
+ * 				scaling curve releases all threads together from a shared barrier and runs the body
+ * 				until duration has elapsed. Each call to the body counts as one operation.
+ *
+ * 				Like other passing output, the scaling curve is only printed in verbose mode. It is
+ * 				always printed when EXPECT_SPEEDUP or EXPECT_FAIRNESS fails.
+ * @param[in]	test: body run by each thread. THREAD_ID() returns the index of the calling thread.
+ * @param[in]	nthreads: maximum number of threads, up to THARNESS_MAX_THREADS.
+ * @param[in]	duration: duration of each point of the scaling curve in milliseconds.
+ * @param[in]	file: name of the file.
+ * @param[in]	func: name of the function.
+ * @param[in]	line: line number of the RUN_CONCURRENT statement. */
+void tharness_run_concurrent(void (*test)(void), unsigned nthreads, unsigned duration, const char* file, const char* func, int32_t line)
+{
+	unsigned threads = 1;
+
+	if(nthreads < 1)
+	{
+		nthreads = 1;
+	}
+	else if(nthreads > THARNESS_MAX_THREADS)
+	{
+		nthreads = THARNESS_MAX_THREADS;
+	}
+
+	tharness.scaling.count = 0;
+
+	while(tharness_run_point(test, threads, duration, file, func, line) && threads < nthreads)
+	{
+		/* Always finish the curve with nthreads, even if the points run out. */
+		if(threads * 2 > nthreads || tharness.scaling.count == THARNESS_MAX_POINTS - 1)
+		{
+			threads = nthreads;
+		}
+		else
+		{
+			threads *= 2;
+		}
+	}
+
+	tharness_lock();
+	tharness_print_scaling();
+	tharness_unlock();
+}
+
+
+/* tharness_thread_id ***************************************************************************//**
+ * @brief		Returns the index of the thread running the current test body. Returns 0 outside of
+ * 				RUN_CONCURRENT. */
+unsigned tharness_thread_id(void)
+{
+	return tharness_thread;
+}
+#endif
+
+
+/* tharness_expect ******************************************************************************//**
+ * @brief		Runs a tharness expect statement. The expect statement passes if condition is true or
+ * 				fails if condition is false.
+ * @param[in]	condition: result of the test. True passes the expect statement. False fails the
+ * 				expect statement.
+ * @param[in]	file: name of the file.
+ * @param[in]	func: name of the function.
+ * @param[in]	line: line number of the expect statement.
+ * @param[in]	str: string of the statement under test.
+ * @param[in]	msg: extra output if the test fails. The message is printed with variadic arguments.
+ * @param[in]	...: variadic arguments passed with msg. */
+void tharness_expect(bool condition, const char* file, const char* func, int32_t line, const char* str, const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+
+	tharness_lock();
+	tharness_handle(THARNESS_RUN_EXPECT_EVENT);
+
+	if(tharness.state == THARNESS_NORMAL_STATE)
+	{
+		if(condition)
+		{
+			tharness_handle(THARNESS_PASSED_EVENT);
+			tharness_print_passed(file, func, line);
+		}
+		else
+		{
+			tharness_handle(THARNESS_FAILED_EVENT);
+			tharness_print_failed(file, func, line);
+			tharness_write_line(1, "Expected %s", str);
+			tharness_vprint_line(1, msg, args);
+		}
+	}
+
+	tharness_unlock();
+	va_end(args);
+}
+
+
+#if THARNESS_THREAD_SAFE
+/* tharness_expect_speedup **********************************************************************//**
+ * @brief		Expects the throughput of the last RUN_CONCURRENT at its maximum number of threads to
+ * 				be at least min times the single threaded throughput. Prints the scaling curve on
+ * 				failure. */
+void tharness_expect_speedup(double min, const char* file, const char* func, int32_t line, const char* str)
+{
+	const TharnessScaling* scaling = &tharness.scaling;
+	double speedup = 0;
+
+	if(scaling->count > 0 && scaling->points[0].ops_per_sec > 0)
+	{
+		speedup = scaling->points[scaling->count-1].ops_per_sec / scaling->points[0].ops_per_sec;
+	}
+
+	tharness_expect_scaling(speedup >= min, file, func, line, "speedup", speedup, str);
+}
+
+
+/* tharness_expect_fairness *********************************************************************//**
+ * @brief		Expects the fairness index of the last RUN_CONCURRENT at its maximum number of
+ * 				threads to be at least min. Prints the scaling curve on failure. */
+void tharness_expect_fairness(double min, const char* file, const char* func, int32_t line, const char* str)
+{
+	const TharnessScaling* scaling = &tharness.scaling;
+	double fairness = 0;
+
+	if(scaling->count > 0)
+	{
+		fairness = scaling->points[scaling->count-1].fairness;
+	}
+
+	tharness_expect_scaling(fairness >= min, file, func, line, "fairness", fairness, str);
+}
+#endif
+
+
+/* tharness_expect_percentile *******************************************************************//**
+ * @brief		Expects a percentile of the histogram to be strictly below limit nanoseconds. A
+ * 				percentile of 100 compares the exact maximum sample. Prints the percentile
+ * 				distribution on failure. Percentiles are the highest value of their bucket so that
+ * 				the comparison errs toward failing. */
+void tharness_expect_percentile(const TharnessHistogram* hist, double percentile, uint64_t limit, const char* file, const char* func, int32_t line, const char* str)
+{
+	uint64_t value = tharness_histogram_percentile(hist, percentile);
+
+	tharness_lock();
+	tharness_handle(THARNESS_RUN_EXPECT_EVENT);
+
+	if(tharness.state == THARNESS_NORMAL_STATE)
+	{
+		if(value < limit)
+		{
+			tharness_handle(THARNESS_PASSED_EVENT);
+			tharness_print_passed(file, func, line);
+		}
+		else
+		{
+			tharness_handle(THARNESS_FAILED_EVENT);
+			tharness_print_failed(file, func, line);
+			tharness_write_line(1, "Expected p%g < %s ns, was %" PRIu64 " ns", percentile, str, value);
+			tharness_print_histogram(hist);
+		}
+	}
+
+	tharness_unlock();
+}
+
+
+/* tharness_clock_ns ****************************************************************************//**
+ * @brief		Returns a monotonic timestamp in nanoseconds for timing samples. */
+uint64_t tharness_clock_ns(void)
+{
+	#if defined(CLOCK_MONOTONIC) || defined(TIME_UTC)
+	struct timespec now;
+
+	#if defined(CLOCK_MONOTONIC)
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	#else
+	timespec_get(&now, TIME_UTC);
+	#endif
+
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+	#else
+	return (uint64_t)((double)clock() * (1e9 / CLOCKS_PER_SEC));
+	#endif
+}
+
+
+/* tharness_histogram_clear *********************************************************************//**
+ * @brief		Removes all samples from a histogram. */
+void tharness_histogram_clear(TharnessHistogram* hist)
+{
+	memset(hist, 0, sizeof(*hist));
+}
+
+
+/* tharness_histogram_merge *********************************************************************//**
+ * @brief		Adds the samples of src to dst. */
+void tharness_histogram_merge(TharnessHistogram* dst, const TharnessHistogram* src)
+{
+	unsigned i;
+
+	for(i = 0; i < THARNESS_HISTOGRAM_BUCKETS; i++)
+	{
+		dst->counts[i] += src->counts[i];
+	}
+
+	if(src->max > dst->max)
+	{
+		dst->max = src->max;
+	}
+
+	if(src->inv_min > dst->inv_min)
+	{
+		dst->inv_min = src->inv_min;
+	}
+}
+
+
+/* tharness_histogram_count *********************************************************************//**
+ * @brief		Returns the number of samples recorded in a histogram. */
+uint64_t tharness_histogram_count(const TharnessHistogram* hist)
+{
+	uint64_t count = 0;
+	unsigned i;
+
+	for(i = 0; i < THARNESS_HISTOGRAM_BUCKETS; i++)
+	{
+		count += hist->counts[i];
+	}
+
+	return count;
+}
+
+
+/* tharness_histogram_min **********************************************************************//**
+ * @brief		Returns the smallest sample recorded in a histogram. Returns 0 if the histogram is
+ * 				empty. */
+uint64_t tharness_histogram_min(const TharnessHistogram* hist)
+{
+	return tharness_histogram_count(hist) ? ~hist->inv_min : 0;
+}
+
+
+/* tharness_histogram_percentile ****************************************************************//**
+ * @brief		Returns the sample at percentile (0 to 100) of a histogram using the nearest rank
+ * 				definition: the smallest sample with at least percentile of the samples at or below
+ * 				it. The value returned is the highest value of the bucket containing the sample,
+ * 				limited to the maximum sample. Returns 0 if the histogram is empty. */
+uint64_t tharness_histogram_percentile(const TharnessHistogram* hist, double percentile)
+{
+	uint64_t count = tharness_histogram_count(hist);
+	uint64_t rank;
+	uint64_t seen = 0;
+	double   exact;
+	unsigned i;
+
+	if(count == 0)
+	{
+		return 0;
+	}
+
+	/* Negative and NaN percentiles select the smallest sample. */
+	if(!(percentile > 0.0))
+	{
+		percentile = 0.0;
+	}
+	else if(percentile >= 100.0)
+	{
+		return hist->max;
+	}
+
+	/* rank = ceil(percentile * count / 100). A fraction within the rounding error of the product
+	 * is treated as an exact rank so that 99.9% of 1000 samples is rank 999, not 1000. */
+	exact = percentile * (double)count / 100.0;
+	rank  = (uint64_t)exact;
+
+	if(exact - (double)rank > exact * 4 * DBL_EPSILON)
+	{
+		rank++;
+	}
+
+	if(rank < 1)
+	{
+		rank = 1;
+	}
+	else if(rank > count)
+	{
+		rank = count;
+	}
+
+	for(i = 0; i < THARNESS_HISTOGRAM_BUCKETS; i++)
+	{
+		seen += hist->counts[i];
+
+		if(seen >= rank)
+		{
+			uint64_t value = tharness_histogram_value(i);
+
+			return value < hist->max ? value : hist->max;
+		}
+	}
+
+	return hist->max;
+}
+
+
+/* tharness_print *******************************************************************************//**
+ * @brief		Prints a msg string. If printing begins on a new line, the message will be indented
+ * 				with the specified number of tab characters up to a maximum of 4 tabs. Printing will
+ * 				be suppressed if verbose output is disabled and the previous test passed.
+ * @warning		Do not use newlines in the msg string. Doing so will break the indenting behavior.
+ * 				However, newlines are acceptable at the end of the msg string. */
+void tharness_print(int indent, const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+
+	tharness_lock();
+	tharness_vprint(indent, msg, args);
+	tharness_unlock();
+
+	va_end(args);
+}
+
+
+/* tharness_print_line **************************************************************************//**
+ * @brief		Prints a string and terminates with a newline. If printing beings on a new line, the
+ * 				message will be indented with the specified number of tab characters up to a maximum
+ * 				of 4 tabs. Printing will be suppressed if verbose output is disabled and the previous
+ * 				test passed.
+ * @warning		Do not use newlines in the msg string. Doing so will break the indenting behavior. */
+void tharness_print_line(int indent, const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+
+	tharness_lock();
+	tharness_vprint_line(indent, msg, args);
+	tharness_unlock();
+
+	va_end(args);
+}
+
+
+/* tharness_pass ********************************************************************************//**
+ * @brief		Causes the current test to pass. */
+void tharness_pass(const char* file, const char* func, int32_t line, const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+
+	tharness_lock();
+	tharness_handle(THARNESS_PASSED_EVENT);
+	tharness_print_passed(file, func, line);
+	tharness_vprint_line(1, msg, args);
+	tharness_unlock();
+
+	va_end(args);
+}
+
+
+/* tharness_fail ********************************************************************************//**
+ * @brief		Causes the current test to fail. */
+void tharness_fail(const char* file, const char* func, int32_t line, const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+
+	tharness_lock();
+	tharness_handle(THARNESS_FAILED_EVENT);
+	tharness_print_failed(file, func, line);
+	tharness_vprint_line(1, msg, args);
+	tharness_unlock();
+
+	va_end(args);
+}
+
+
+/* tharness_ignored *****************************************************************************//**
+ * @brief		Causes current test to not run. */
+void tharness_ignore(const char* file, const char* func, int32_t line, const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+
+	tharness_lock();
+	tharness_handle(THARNESS_IGNORED_EVENT);
+	tharness_print_ignored(file, func, line);
+	tharness_vprint_line(1, msg, args);
+	tharness_unlock();
+
+	va_end(args);
+}
+
+
+/* tharness_handle ******************************************************************************//**
+ * @brief		Handles tharness state. */
+static void tharness_handle(unsigned event)
+{
+	switch(tharness.state)
+	{
+		/* This is the normal test harness state. This state is entered whenever a new TEST is run.
+		 * This state is exited whenever an EXPECT statement fails or a test is IGNORED. */
+		case THARNESS_NORMAL_STATE:
+		{
+			switch(event)
+			{
+				case THARNESS_FAILED_EVENT:
+					tharness.failures++;
+					tharness.state = THARNESS_FAILING_STATE;
+					break;
+
+				case THARNESS_IGNORED_EVENT:
+					tharness.ignores++;
+					tharness.state = THARNESS_IGNORING_STATE;
+					break;
+
+				case THARNESS_RUN_TEST_EVENT:
+					tharness.total++;
+					break;
+
+				case THARNESS_RESULTS_EVENT:
+					tharness.state = THARNESS_RESULTS_STATE;
+					break;
+
+				default: break;
+			}
+			break;
+		}
+
+		/* The ignoring state is entered whenever TEST_IGNORE is called. This state is exited for the
+		 * ignored state on the next EXPECT, TEST_FAIL, TEST_IGNORE, or TEST_PASS call. This state
+		 * exists to allow PRINT statements to output messages for the preceding TEST_IGNORE. Running
+		 * a new test transitions to the normal state. */
+		case THARNESS_IGNORING_STATE:
+		{
+			switch(event)
+			{
+				case THARNESS_FAILED_EVENT:
+					tharness.state = THARNESS_IGNORED_STATE;
+					break;
+
+				case THARNESS_PASSED_EVENT:
+					tharness.state = THARNESS_IGNORED_STATE;
+					break;
+
+				case THARNESS_IGNORED_EVENT:
+					tharness.state = THARNESS_IGNORED_STATE;
+					break;
+
+				case THARNESS_RUN_TEST_EVENT:
+					tharness.state = THARNESS_NORMAL_STATE;
+					tharness.total++;
+					break;
+
+				case THARNESS_RUN_EXPECT_EVENT:
+					tharness.state = THARNESS_IGNORED_STATE;
+					break;
+
+				case THARNESS_RESULTS_EVENT:
+					tharness.state = THARNESS_RESULTS_STATE;
+					break;
+
+				default: break;
+			}
+			break;
+		}
+
+		/* This state is entered by any subsequent EXPECT, TEST_PASS, TEST_FAIL, or TEST_IGNORE
+		 * following a TEST_IGNORE call. This state suppresses print output for the currently running
+		 * test. Running a new test transitions to the normal state. */
+		case THARNESS_IGNORED_STATE:
+		{
+			switch(event)
+			{
+				case THARNESS_RUN_TEST_EVENT:
+					tharness.state = THARNESS_NORMAL_STATE;
+					tharness.total++;
+					break;
+
+				case THARNESS_RESULTS_EVENT:
+					tharness.state = THARNESS_RESULTS_STATE;
+					break;
+
+				default: break;
+			}
+			break;
+		}
+
+		/* The failing state is entered whenever an EXPECT statement fails or TEST_FAIL is called.
+		 * This state is exited for the failed state on the next EXPECT, TEST_FAIL, TEST_IGNORE,
+		 * or TEST_PASS call. This state exists to allow print statements to output messages for the
+		 * last failing EXPECT statement. Runninga new test transitions to the normal state. */
+		case THARNESS_FAILING_STATE:
+		{
+			switch(event)
+			{
+				case THARNESS_FAILED_EVENT:
+					tharness.state = THARNESS_FAILED_STATE;
+					break;
+
+				case THARNESS_PASSED_EVENT:
+					tharness.state = THARNESS_FAILED_STATE;
+					break;
+
+				case THARNESS_IGNORED_EVENT:
+					tharness.state = THARNESS_FAILED_STATE;
+					break;
+
+				case THARNESS_RUN_TEST_EVENT:
+					tharness.state = THARNESS_NORMAL_STATE;
+					tharness.total++;
+					break;
+
+				case THARNESS_RUN_EXPECT_EVENT:
+					tharness.state = THARNESS_FAILED_STATE;
+					break;
+
+				case THARNESS_RESULTS_EVENT:
+					tharness.state = THARNESS_RESULTS_STATE;
+					break;
+
+				default: break;
+			}
+			break;
+		}
+
+		/* This state is entered by any subsequent EXPECT, TEST_PASS, TEST_FAIL, or TEST_IGNORE
+		 * following a failing EXPECT statement or TEST_FAIL. This state suppresses print output for
+		 * the currently running test. Running a new test transitions to the normal state. */
+		case THARNESS_FAILED_STATE:
+		{
+			switch(event)
+			{
+				case THARNESS_RUN_TEST_EVENT:
+					tharness.state = THARNESS_NORMAL_STATE;
+					tharness.total++;
+					break;
+
+				case THARNESS_RESULTS_EVENT:
+					tharness.state = THARNESS_RESULTS_STATE;
+					break;
+
+				default: break;
+			}
+			break;
+		}
+
+		default: break;
+	}
+}
+
+
+#if THARNESS_THREAD_SAFE
+/* tharness_run_point ***************************************************************************//**
+ * @brief		Runs the body of a test on nthreads threads for duration milliseconds and appends
+ * 				the result to the scaling curve. Returns false and fails the test at file, func, and
+ * 				line if the threads could not be started. */
+static bool tharness_run_point(void (*test)(void), unsigned nthreads, unsigned duration, const char* file, const char* func, int32_t line)
+{
+	pthread_t       threads[THARNESS_MAX_THREADS];
+	TharnessWorker  workers[THARNESS_MAX_THREADS];
+	struct timespec deadline;
+	uint64_t start, end;
+	unsigned i, created;
+
+	atomic_store(&tharness_stop, false);
+	tharness_gate_ready = 0;
+	tharness_gate_open  = false;
+
+	for(created = 0; created < nthreads; created++)
+	{
+		workers[created].test = test;
+		workers[created].id   = created;
+		tharness_counters[created].ops = 0;
+
+		if(pthread_create(&threads[created], 0, tharness_worker, &workers[created]) != 0)
+		{
+			atomic_store(&tharness_stop, true);
+			break;
+		}
+	}
+
+	/* Release all threads from the barrier together once every thread has arrived. */
+	pthread_mutex_lock(&tharness_gate_mutex);
+	while(tharness_gate_ready < created)
+	{
+		pthread_cond_wait(&tharness_gate_cond, &tharness_gate_mutex);
+	}
+	tharness_gate_open = true;
+	pthread_cond_broadcast(&tharness_gate_cond);
+	pthread_mutex_unlock(&tharness_gate_mutex);
+
+	start = tharness_clock_ns();
+
+	/* Sleep until the deadline. pthread_cond_timedwait waits on the realtime clock. */
+	if(created == nthreads)
+	{
+		#if defined(CLOCK_REALTIME)
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		#else
+		timespec_get(&deadline, TIME_UTC);
+		#endif
+
+		deadline.tv_sec  += duration / 1000;
+		deadline.tv_nsec += (long)(duration % 1000) * 1000000L;
+
+		if(deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec  += 1;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		pthread_mutex_lock(&tharness_gate_mutex);
+		while(pthread_cond_timedwait(&tharness_gate_cond, &tharness_gate_mutex, &deadline) == 0) { }
+		pthread_mutex_unlock(&tharness_gate_mutex);
+
+		atomic_store(&tharness_stop, true);
+	}
+
+	for(i = 0; i < created; i++)
+	{
+		pthread_join(threads[i], 0);
+	}
+
+	end = tharness_clock_ns();
+
+	if(created != nthreads)
+	{
+		tharness_fail(file, func, line, "Could not start %u threads", nthreads);
+		return false;
+	}
+
+	/* Jain's fairness index: (sum x)^2 / (n * sum x^2). */
+	TharnessScalingPoint* point = &tharness.scaling.points[tharness.scaling.count++];
+	double sum = 0;
+	double sum_sq = 0;
+
+	point->threads = nthreads;
+	point->ops     = 0;
+
+	for(i = 0; i < nthreads; i++)
+	{
+		point->ops += tharness_counters[i].ops;
+		sum        += (double)tharness_counters[i].ops;
+		sum_sq     += (double)tharness_counters[i].ops * (double)tharness_counters[i].ops;
+	}
+
+	point->seconds     = (double)(end - start) / 1e9;
+	point->ops_per_sec = point->seconds > 0 ? (double)point->ops / point->seconds : 0;
+	point->fairness    = sum_sq > 0 ? (sum * sum) / (nthreads * sum_sq) : 0;
+
+	return true;
+}
+
+
+/* tharness_worker ******************************************************************************//**
+ * @brief		Thread started by tharness_run_point. Waits at the barrier then runs the test body
+ * 				until stopped. Operations are counted locally and published once at the end to avoid
+ * 				contending with the test body. */
+static void* tharness_worker(void* arg)
+{
+	const TharnessWorker* worker = arg;
+	uint64_t ops = 0;
+
+	tharness_thread = worker->id;
+
+	pthread_mutex_lock(&tharness_gate_mutex);
+	tharness_gate_ready++;
+	pthread_cond_broadcast(&tharness_gate_cond);
+	while(!tharness_gate_open)
+	{
+		pthread_cond_wait(&tharness_gate_cond, &tharness_gate_mutex);
+	}
+	pthread_mutex_unlock(&tharness_gate_mutex);
+
+	while(!atomic_load_explicit(&tharness_stop, memory_order_relaxed))
+	{
+		worker->test();
+		ops++;
+	}
+
+	tharness_counters[worker->id].ops = ops;
+
+	return 0;
+}
+
+
+/* tharness_expect_scaling **********************************************************************//**
+ * @brief		Common implementation of EXPECT_SPEEDUP and EXPECT_FAIRNESS. */
+static void tharness_expect_scaling(bool condition, const char* file, const char* func, int32_t line, const char* name, double value, const char* str)
+{
+	tharness_lock();
+	tharness_handle(THARNESS_RUN_EXPECT_EVENT);
+
+	if(tharness.state == THARNESS_NORMAL_STATE)
+	{
+		if(condition)
+		{
+			tharness_handle(THARNESS_PASSED_EVENT);
+			tharness_print_passed(file, func, line);
+		}
+		else
+		{
+			tharness_handle(THARNESS_FAILED_EVENT);
+			tharness_print_failed(file, func, line);
+			tharness_write_line(1, "Expected %s >= %s, was %.2f", name, str, value);
+			tharness_print_scaling();
+		}
+	}
+
+	tharness_unlock();
+}
+
+
+/* tharness_print_scaling ***********************************************************************//**
+ * @brief		Prints the scaling curve of the last RUN_CONCURRENT. Example output:
+ *
+ * 				threads      ops/sec  speedup  fairness
+ * 				      1     10512345     1.00     1.000
+ * 				      2     20841020     1.98     0.999
+ */
+static void tharness_print_scaling(void)
+{
+	const TharnessScaling* scaling = &tharness.scaling;
+	unsigned i;
+
+	tharness_write_line(1, "threads      ops/sec  speedup  fairness");
+
+	for(i = 0; i < scaling->count; i++)
+	{
+		const TharnessScalingPoint* point = &scaling->points[i];
+		double speedup = scaling->points[0].ops_per_sec > 0 ?
+			point->ops_per_sec / scaling->points[0].ops_per_sec : 0;
+
+		tharness_write_line(1, "%7u %12.0f %8.2f %9.3f",
+			point->threads, point->ops_per_sec, speedup, point->fairness);
+	}
+}
+#endif
+
+
+/* tharness_print_histogram ********************************************************************//**
+ * @brief		Prints the percentile distribution of a histogram. Example output:
+ *
+ * 				samples 1000  min 1 ns
+ * 				p50              503 ns
+ * 				p75              751 ns
+ * 				...
+ * 				p99.99          1000 ns
+ * 				max             1000 ns
+ */
+static void tharness_print_histogram(const TharnessHistogram* hist)
+{
+	static const double percentiles[] = { 50.0, 75.0, 90.0, 99.0, 99.9, 99.99, 100.0 };
+	unsigned i;
+
+	tharness_write_line(1, "samples %" PRIu64 "  min %" PRIu64 " ns",
+		tharness_histogram_count(hist), tharness_histogram_min(hist));
+
+	for(i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+	{
+		if(percentiles[i] < 100.0)
+		{
+			tharness_write_line(1, "p%-6g %12" PRIu64 " ns", percentiles[i],
+				tharness_histogram_percentile(hist, percentiles[i]));
+		}
+		else
+		{
+			tharness_write_line(1, "max     %12" PRIu64 " ns", hist->max);
+		}
+	}
+}
+
+
+/* tharness_histogram_value *********************************************************************//**
+ * @brief		Returns the highest value recorded in a histogram bucket. This is the inverse of the
+ * 				bucketing in tharness_histogram_record. */
+static uint64_t tharness_histogram_value(unsigned index)
+{
+	const unsigned half = 1u << (THARNESS_HISTOGRAM_BITS - 1);
+	unsigned shift;
+	uint64_t mantissa;
+
+	if(index < 2 * half)
+	{
+		return index;
+	}
+
+	shift    = index / half - 1;
+	mantissa = index - shift * half;
+
+	return ((mantissa + 1) << shift) - 1;
+}
+
+
+/* tharness_passed ******************************************************************************//**
+ * @brief		Outputs a message for a passing step in a test. */
+static inline void tharness_print_passed(const char* file, const char* func, int32_t line)
+{
+	#if THARNESS_VERBOSE
+	tharness_write_line(0, "%s:%d: %s: OK", file, line, func);
+	#else
+	(void)file;
+	(void)func;
+	(void)line;
+	#endif
+}
+
+
+/* tharness_failed ******************************************************************************//**
+ * @brief		Outputs a message for a failing step in a test. The test harness is modified to
+ *				indicate that the test has failed. */
+static inline void tharness_print_failed(const char* file, const char* func, int32_t line)
+{
+	tharness_write_line(0, "%s:%d: %s: FAIL", file, line, func);
+}
+
+
+/* tharness_failed ******************************************************************************//**
+ * @brief		Outputs a message for an ignored step in a test. */
+static inline void tharness_print_ignored(const char* file, const char* func, int32_t line)
+{
+	tharness_write_line(0, "%s:%d: %s: IGNORED", file, line, func);
+}
+
+
+/* tharness_can_output **************************************************************************//**
+ * @brief		Returns true if output can be printed. */
+static inline bool tharness_can_output(void)
+{
+	return
+		#if THARNESS_VERBOSE
+		tharness.verbose ||
+		#endif
+		tharness.state == THARNESS_FAILING_STATE ||
+		tharness.state == THARNESS_IGNORING_STATE ||
+		tharness.state == THARNESS_RESULTS_STATE;
+}
+
+
+/* tharness_vprint ******************************************************************************//**
+ * @brief		Performs the same operation as tharness_print but uses the va_list directly. */
+static inline void tharness_vprint(int indent, const char* msg, va_list args)
+{
+	if(tharness_can_output())
+	{
+		if(tharness.at_new_line == true)
+		{
+			tharness_output("%.*s", indent, "\t\t\t\t");
+		}
+
+		if(msg)
+		{
+			THARNESS_VPRINTF(msg, args);
+
+			tharness.at_new_line = (msg[strlen(msg)-1] == '\n');
+		}
+	}
+}
+
+
+/* tharness_vprint_line *************************************************************************//**
+ * @brief		Performs the same operation as tharness_print_line but uses the va_list directly. */
+static inline void tharness_vprint_line(int indent, const char* msg, va_list args)
+{
+	if(msg)
+	{
+		tharness_vprint(indent, msg, args);
+		tharness_write(indent, "\n");
+	}
+}
+
+
+/* tharness_output ******************************************************************************//**
+ * @brief		Sends formatted output directly to the THARNESS_VPRINTF sink. */
+static void tharness_output(const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+
+	THARNESS_VPRINTF(msg, args);
+
+	va_end(args);
+}
+
+
+/* tharness_write *******************************************************************************//**
+ * @brief		Performs the same operation as tharness_print without taking the tharness lock. Used
+ * 				by functions that already hold the lock. */
+static void tharness_write(int indent, const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+
+	tharness_vprint(indent, msg, args);
+
+	va_end(args);
+}
+
+
+/* tharness_write_line **************************************************************************//**
+ * @brief		Performs the same operation as tharness_print_line without taking the tharness lock.
+ * 				Used by functions that already hold the lock. */
+static void tharness_write_line(int indent, const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+
+	tharness_vprint_line(indent, msg, args);
+
+	va_end(args);
+}
+
+
+/* tharness_lock ********************************************************************************//**
+ * @brief		Serializes tharness state and output between threads running RUN_CONCURRENT. */
+static inline void tharness_lock(void)
+{
+	#if THARNESS_THREAD_SAFE
+	pthread_mutex_lock(&tharness_mutex);
+	#endif
+}
+
+
+/* tharness_unlock ******************************************************************************//**
+ * @brief		Releases the lock taken by tharness_lock. */
+static inline void tharness_unlock(void)
+{
+	#if THARNESS_THREAD_SAFE
+	pthread_mutex_unlock(&tharness_mutex);
+	#endif
+}
+
+#endif // THARNESS_IMPLEMENTATION
 /******************************************* END OF FILE *******************************************/